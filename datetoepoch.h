@@ -1 +1,3 @@
-extern time_t Date2Epoch(const char *date_s, const char *time_s);
+#include <stdint.h>
+
+extern int64_t TcDate2EpochMs(const char *date_s, const char *time_s);
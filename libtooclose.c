@@ -0,0 +1,701 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+#include <errno.h>
+#include "tooclose.h"
+#include "metar.h"
+#include "datetoepoch.h"
+#include "shmwriter.h"
+#include "trace.h"
+
+// Limits
+static const double Horizontal_Separation = 2.0 / 3.0; // nautical miles
+static const int32_t Vertical_Separation = 750; // feet
+static const int32_t Speed_Minimum = 120; // at least one plane faster than in kts, filter out multiple hovering TV helicopters and light plane departures
+static const int32_t Altitude_Minimum = 700; // both planes higher than in feet, filter out local airport operations
+
+#define PLANE_COUNT 1024 // never more than about 70 planes visible from the casa
+#define RAW_STRING_LEN TC_RAW_STRING_LEN
+#define CALLSIGN_LEN TC_CALLSIGN_LEN
+
+_Static_assert(PLANE_COUNT <= SHM_PLANE_COUNT, "ShmPublishPlanes() copies every valid plane into the shared table");
+
+typedef struct plane_t {
+        uint32_t valid;
+        uint32_t icao;
+        time_t last_seen;
+#ifdef TC_TRACE
+        int64_t last_seen_ms; // receiver time of the last message, for TRACE_RECEIVER_DELAY
+#endif
+        time_t last_speed;
+        time_t last_location_time;
+        char callsign[CALLSIGN_LEN];
+        uint32_t latlong_valid;
+        float latitude;
+        float longitude;
+        double lat_radians;
+        double lon_radians;
+        float prev_latitude;
+        float prev_longitude;
+        float prev_latitude_radians;
+        float prev_longitude_radians;
+        int32_t speed;
+        int32_t altitude;
+        int32_t reported;
+        char msg3[RAW_STRING_LEN];
+} plane_t;
+
+struct tc_t {
+        plane_t planes[PLANE_COUNT];
+        int plane_list_count;
+        time_t receiver_now;
+        tc_stats_t stats;
+        tc_alert_fn alert;
+        void *alert_arg;
+        tc_metar_fn metar;
+        void *metar_arg;
+        char metar_station[8]; // empty unless tc_set_metar_station()
+        double metar_temp_c;
+        shm_table_t *shm_table; // null unless tc_shm_publish()
+        char *shm_name;
+        int shm_lock_fd;
+};
+
+static double
+deg2rad(double d)
+{
+        double r;
+
+        r = (d * M_PI) / 180.0;
+
+        return r;
+}
+
+static double
+rad2deg(double rad)
+{
+        return rad * 180.0 / M_PI;
+}
+
+static double
+CalcDistance(double lat1, double lon1, double lat2, double lon2)
+{
+        double theta, dist;
+
+        theta = lon1 - lon2;
+        dist = sin(lat1) * sin(lat2) + cos(lat1) * cos(lat2) * cos(theta);
+        dist = acos(dist);
+        dist = rad2deg(dist);
+        dist = dist * 60.0 * 1.1515 * 0.8684; // nautical miles https://www.geodatasource.com/developers/c
+
+        return dist;
+}
+
+static void
+ShmCopyPlane(shm_plane_t *shm_plane, plane_t *plane)
+{
+        shm_plane->icao = plane->icao;
+        strncpy(shm_plane->callsign, plane->callsign, SHM_CALLSIGN_LEN - 1);
+        shm_plane->callsign[SHM_CALLSIGN_LEN - 1] = '\0';
+        shm_plane->last_seen = plane->last_seen;
+        shm_plane->last_location_time = plane->last_location_time;
+        shm_plane->latitude = plane->latitude;
+        shm_plane->longitude = plane->longitude;
+        shm_plane->altitude = plane->altitude;
+        shm_plane->speed = plane->speed;
+        shm_plane->latlong_valid = plane->latlong_valid;
+}
+
+static void
+ShmPublishEncounter(shm_table_t *table, plane_t *plane0, plane_t *plane1, double horiz_sep, int32_t verti_sep)
+{
+        shm_encounter_t *encounter;
+
+        TcShmTableWriteBegin(table);
+        encounter = &table->encounters[table->encounter_count % SHM_ENCOUNTER_COUNT];
+        encounter->time = plane0->last_seen;
+        encounter->horiz_sep = horiz_sep;
+        encounter->verti_sep = verti_sep;
+        ShmCopyPlane(&encounter->plane[0], plane0);
+        ShmCopyPlane(&encounter->plane[1], plane1);
+        ++table->encounter_count;
+        TcShmTableWriteEnd(table);
+}
+
+static void
+ShmPublishPlanes(tc_t *tc)
+{
+        int i;
+        uint32_t plane_count;
+        shm_table_t *table;
+
+        table = tc->shm_table;
+        TcShmTableWriteBegin(table);
+        plane_count = 0;
+        for (i = 0; i < tc->plane_list_count; ++i)
+                if (tc->planes[i].valid)
+                        ShmCopyPlane(&table->planes[plane_count++], &tc->planes[i]);
+        table->plane_count = plane_count;
+        table->receiver_now = tc->receiver_now;
+        TcShmTableWriteEnd(table);
+}
+
+static void
+AlertCopyPlane(tc_aircraft_t *aircraft, plane_t *plane)
+{
+        aircraft->icao = plane->icao;
+        strncpy(aircraft->callsign, plane->callsign, CALLSIGN_LEN - 1);
+        aircraft->callsign[CALLSIGN_LEN - 1] = '\0';
+        aircraft->last_seen = plane->last_seen;
+        aircraft->last_location_time = plane->last_location_time;
+        aircraft->latitude = plane->latitude;
+        aircraft->longitude = plane->longitude;
+        aircraft->altitude = plane->altitude;
+        aircraft->speed = plane->speed;
+        strncpy(aircraft->msg3, plane->msg3, RAW_STRING_LEN - 1);
+        aircraft->msg3[RAW_STRING_LEN - 1] = '\0';
+}
+
+static void
+AlertClosePlanes(tc_t *tc, plane_t *plane0, plane_t *plane1, double horiz_sep, int32_t verti_sep)
+{
+        tc_alert_t alert;
+
+        TRACE_RECEIVER_DELAY(plane0->last_seen_ms > plane1->last_seen_ms ? plane0->last_seen_ms : plane1->last_seen_ms);
+        if (tc->alert)
+        {
+                TRACE_START(report_start);
+                AlertCopyPlane(&alert.plane[0], plane0);
+                AlertCopyPlane(&alert.plane[1], plane1);
+                alert.horiz_sep = horiz_sep;
+                alert.verti_sep = verti_sep;
+                tc->alert(&alert, tc->alert_arg);
+                TRACE_STOP(TRACE_REPORT, report_start);
+        }
+        if (tc->shm_table)
+                ShmPublishEncounter(tc->shm_table, plane0, plane1, horiz_sep, verti_sep);
+}
+
+static uint32_t
+PlaneCheck(plane_t *plane0, plane_t *plane1)
+{
+        uint32_t valid_planes;
+
+        valid_planes =
+                plane0->valid && ! plane0->reported && plane0->latlong_valid > 2 && plane0->altitude >= Altitude_Minimum &&
+                plane1->valid && ! plane1->reported && plane1->latlong_valid > 2 && plane1->altitude >= Altitude_Minimum &&
+                (plane0->speed >= Speed_Minimum || plane1->speed >= Speed_Minimum);
+
+        return valid_planes;
+}
+
+static void
+DetectClosePlanes(tc_t *tc)
+{
+        int32_t i, j;
+        int32_t verti_sep;
+        double horiz_sep;
+        int32_t time_sep;
+        plane_t *planes;
+
+        planes = tc->planes;
+        for (i = 0; i < tc->plane_list_count - 1; ++i)
+        {
+                for (j = i + 1; j < tc->plane_list_count; ++j)
+                {
+                        if (PlaneCheck(&planes[i], &planes[j]))
+                        {
+                                horiz_sep = CalcDistance(planes[i].lat_radians, planes[i].lon_radians, planes[j].lat_radians, planes[j].lon_radians);
+                                verti_sep = labs(planes[i].altitude - planes[j].altitude);
+                                time_sep = labs(planes[i].last_location_time - planes[j].last_location_time);
+                                if (horiz_sep < Horizontal_Separation && verti_sep < Vertical_Separation && time_sep == 0)
+                                {
+                                        AlertClosePlanes(tc, &planes[i], &planes[j], horiz_sep, verti_sep);
+                                        ++planes[i].reported;
+                                        ++planes[j].reported;
+                                }
+                        }
+                }
+        }
+}
+
+// Returns 0 if every slot holds an aircraft heard in the last 10 seconds
+static plane_t *
+InsertPlane(tc_t *tc, uint32_t icao)
+{
+        int i;
+        plane_t *planes;
+
+        planes = tc->planes;
+        i = 0;
+        while (i < PLANE_COUNT && planes[i].valid)
+                ++i;
+        if (i == PLANE_COUNT)
+                return 0;
+        if (i >= tc->plane_list_count)
+                tc->plane_list_count = i + 1;
+
+        planes[i].valid = 1;
+        planes[i].reported = 0;
+        planes[i].icao = icao;
+        planes[i].last_seen = 0;
+#ifdef TC_TRACE
+        planes[i].last_seen_ms = 0;
+#endif
+        planes[i].last_speed = 0;
+        planes[i].last_location_time = 0;
+        strcpy(planes[i].callsign, "unknown ");
+        planes[i].latlong_valid = 0;
+        planes[i].speed = -1;
+        planes[i].altitude = -100000;
+        planes[i].latitude = 0;
+        planes[i].longitude = 0;
+        planes[i].lat_radians = 0;
+        planes[i].lon_radians = 0;
+        planes[i].msg3[0] = '\0';
+
+        return &planes[i];
+}
+
+static plane_t *
+FindPlane(tc_t *tc, uint32_t icao)
+{
+        int i;
+        plane_t *plane;
+
+        i = 0;
+        while (i < tc->plane_list_count && ! (tc->planes[i].icao == icao && tc->planes[i].valid))
+                ++i;
+        if (i == tc->plane_list_count)
+        {
+                if ((plane = InsertPlane(tc, icao)) != 0)
+                        ++tc->stats.flight_count;
+        }
+        else
+                plane = &tc->planes[i];
+
+        return plane;
+}
+
+static time_t
+MsToSeen(int64_t t_ms)
+{
+        return (t_ms + 500) / 1000; // round to the nearest second
+}
+
+static plane_t *
+UpdateSeen(tc_t *tc, uint32_t icao, int64_t t_ms)
+{
+        plane_t *plane;
+        TRACE_START(lookup_start);
+
+        plane = FindPlane(tc, icao);
+        TRACE_STOP(TRACE_LOOKUP, lookup_start);
+        tc->receiver_now = MsToSeen(t_ms); // even when full, so tc_detect() can make room
+        if (plane == 0)
+                return 0;
+        plane->last_seen = tc->receiver_now;
+#ifdef TC_TRACE
+        plane->last_seen_ms = t_ms;
+#endif
+
+        return plane;
+}
+
+static int
+PositionCheck(double lat, double lon, int32_t altitude)
+{
+        return altitude >= -500 && altitude <= 100000 && lat >= -90.0 && lat <= 90.0 && lon >= -180.0 && lon <= 180.0;
+}
+
+static int
+SpeedCheck(int32_t speed)
+{
+        return speed > 0 && speed <= 3000;
+}
+
+static int
+CallsignCheck(const char *callsign)
+{
+        return callsign != 0 && *callsign != '\0';
+}
+
+// The Update*() setters trust their caller to have run the matching *Check()
+
+static void
+UpdatePosition(tc_t *tc, plane_t *plane, float lat, float lon, int32_t altitude)
+{
+        double metar_temp_c, metar_elevation_m;
+        double location_check;
+
+        plane->last_location_time = plane->last_seen;
+        plane->altitude = altitude;
+        if (plane->latlong_valid > 0)
+        {
+                plane->prev_latitude = plane->latitude;
+                plane->prev_longitude = plane->longitude;
+                plane->prev_latitude_radians = plane->lat_radians;
+                plane->prev_longitude_radians = plane->lon_radians;
+        }
+        plane->latitude = lat;
+        plane->longitude = lon;
+        plane->lat_radians = deg2rad(lat);
+        plane->lon_radians = deg2rad(lon);
+        ++plane->latlong_valid;
+        if (plane->latlong_valid > 1)
+        {
+                location_check = CalcDistance(plane->lat_radians, plane->lon_radians, plane->prev_latitude_radians, plane->prev_longitude_radians);
+                if (location_check > 3) // NM diff between location squitters
+                        plane->latlong_valid = 0; // posible corrupted location data in squitter, start over
+        }
+        plane->msg3[0] = '\0';
+        if (tc->metar_station[0])
+        {
+                TRACE_START(metar_start);
+                if (TcMETARFetch(tc->metar_station, &metar_temp_c, &metar_elevation_m) && tc->metar)
+                        tc->metar(tc->metar_station, metar_elevation_m, tc->metar_temp_c, metar_temp_c, tc->metar_arg);
+                tc->metar_temp_c = metar_temp_c;
+                TRACE_STOP(TRACE_METAR, metar_start);
+        }
+}
+
+static void
+UpdateSpeed(plane_t *plane, int32_t speed)
+{
+        plane->last_speed = plane->last_seen;
+        plane->speed = speed;
+}
+
+static void
+UpdateCallsign(plane_t *plane, const char *callsign)
+{
+        strncpy(plane->callsign, callsign, sizeof(plane->callsign) - 1);
+}
+
+static void
+ProcessMSG3(char **pp, tc_t *tc, plane_t *plane, char raw_string[RAW_STRING_LEN])
+{
+        char *ch;
+        int field;
+        int32_t altitude;
+        float lat, lon;
+
+        field = 0;
+        while ((ch = strsep(pp, ",")) && field < 3)
+                ++field;
+        if (ch == 0)
+                return;
+        altitude = strtol(ch, 0, 10);
+
+        field = 0;
+        while ((ch = strsep(pp, ",")) && field < 2)
+                ++field;
+        if (ch == 0)
+                return;
+
+        lat = 1000.0;
+        sscanf(ch, "%f", &lat);
+        if (lat == 1000.0) // bad squiiter
+                return;
+        ch = strsep(pp, ",");
+        if (ch == 0)
+                return;
+        lon = 1000.0;
+        sscanf(ch, "%f", &lon);
+        if (lon == 1000.0) // bad squitter
+                return;
+
+        if (! PositionCheck(lat, lon, altitude))
+                return;
+
+        UpdatePosition(tc, plane, lat, lon, altitude);
+        strncpy(plane->msg3, raw_string, RAW_STRING_LEN - 1);
+}
+
+static void
+ProcessMSG4(char **pp, plane_t *plane)
+{
+        char *ch;
+        int field;
+        int32_t speed;
+
+        field = 0;
+        while ((ch = strsep(pp, ",")) && field < 4)
+                ++field;
+        if (ch == 0)
+                return;
+
+        speed = strtol(ch, 0, 10);
+        if (SpeedCheck(speed))
+                UpdateSpeed(plane, speed);
+}
+
+static void
+ProcessMSG1(char **pp, plane_t *plane)
+{
+        char *ch;
+        int field;
+
+        field = 0;
+        while ((ch = strsep(pp, ",")) && field < 2)
+                ++field;
+        if (CallsignCheck(ch))
+                UpdateCallsign(plane, ch);
+}
+
+// Returns -1 if the aircraft table is full
+static int
+ProcessPlane(char **pp, tc_t *tc, uint32_t message_id, uint32_t icao, char *raw_string)
+{
+        plane_t *plane;
+        char *ch, *date_s, *time_s;
+        int64_t t_ms;
+
+        ch = strsep(pp, ",");
+        if (ch == 0 || *ch == '\0')
+                return 0;
+        date_s = strsep(pp, ",");
+        if (date_s == 0 || *date_s == '\0')
+                return 0;
+        time_s = strsep(pp, ",");
+        if (time_s == 0 || *time_s == '\0')
+                return 0;
+
+        TRACE_START(date_start);
+        t_ms = TcDate2EpochMs(date_s, time_s);
+        TRACE_STOP(TRACE_DATE2EPOCH, date_start);
+        if ((plane = UpdateSeen(tc, icao, t_ms)) == 0)
+                return -1;
+
+        switch (message_id)
+        {
+        case 1 :
+                ProcessMSG1(pp, plane);
+                break;
+        case 3 :
+                ProcessMSG3(pp, tc, plane, raw_string);
+                break;
+        case 4 :
+                ProcessMSG4(pp, plane);
+                break;
+        }
+
+        return 0;
+}
+
+static void
+CleanPlanes(tc_t *tc, time_t now)
+{
+        int i, last_valid_plane;
+        uint32_t plane_count;
+        time_t duration;
+        plane_t *planes;
+
+        planes = tc->planes;
+        plane_count = 0;
+        last_valid_plane = tc->plane_list_count - 1;
+        for (i = 0; i < tc->plane_list_count; ++i)
+        {
+                if (planes[i].valid)
+                {
+                        ++plane_count;
+                        duration = now - planes[i].last_seen;
+                        if (duration > 10)
+                        {
+                                planes[i].valid = 0;
+                                planes[i].latlong_valid = 0;
+                        }
+                        else
+                                last_valid_plane = i;
+                }
+        }
+        if (plane_count > tc->stats.max_plane_count)
+                tc->stats.max_plane_count = plane_count;
+        tc->plane_list_count = last_valid_plane + 1;
+}
+
+tc_t *
+tc_create(tc_alert_fn alert, void *arg)
+{
+        tc_t *tc;
+
+        if ((tc = calloc(1, sizeof(tc_t))) == 0)
+                return 0;
+        tc->alert = alert;
+        tc->alert_arg = arg;
+        tc->receiver_now = time(0);
+        tc->metar_temp_c = 15.0; // TcMETARFetch() default until the first refresh
+
+        return tc;
+}
+
+void
+tc_destroy(tc_t *tc)
+{
+        if (tc->shm_table)
+        {
+                TcShmTableDestroy(tc->shm_table, tc->shm_name, tc->shm_lock_fd);
+                free(tc->shm_name);
+        }
+        free(tc);
+}
+
+int
+tc_update_seen(tc_t *tc, uint32_t icao, int64_t t_ms)
+{
+        ++tc->stats.message_count;
+        if (UpdateSeen(tc, icao, t_ms) == 0)
+                return -1;
+
+        return 0;
+}
+
+int
+tc_update_position(tc_t *tc, uint32_t icao, int64_t t_ms, double lat, double lon, int32_t alt)
+{
+        plane_t *plane;
+
+        ++tc->stats.message_count;
+        if (! PositionCheck(lat, lon, alt) || (plane = UpdateSeen(tc, icao, t_ms)) == 0)
+                return -1;
+        UpdatePosition(tc, plane, lat, lon, alt);
+
+        return 0;
+}
+
+int
+tc_update_speed(tc_t *tc, uint32_t icao, int64_t t_ms, int32_t speed)
+{
+        plane_t *plane;
+
+        ++tc->stats.message_count;
+        if (! SpeedCheck(speed) || (plane = UpdateSeen(tc, icao, t_ms)) == 0)
+                return -1;
+        UpdateSpeed(plane, speed);
+
+        return 0;
+}
+
+int
+tc_update_callsign(tc_t *tc, uint32_t icao, int64_t t_ms, const char *callsign)
+{
+        plane_t *plane;
+
+        ++tc->stats.message_count;
+        if (! CallsignCheck(callsign) || (plane = UpdateSeen(tc, icao, t_ms)) == 0)
+                return -1;
+        UpdateCallsign(plane, callsign);
+
+        return 0;
+}
+
+// Parse one dump1090 BaseStation line, returns -1 if it is not an MSG line
+// or was dropped because the aircraft table is full
+int
+tc_process_sbs(tc_t *tc, const char *line)
+{
+        uint32_t message_id, icao;
+        char buffer[1024], raw_string[RAW_STRING_LEN];
+        char *p;
+        char *ch;
+        TRACE_START(tokenise_start);
+
+        strncpy(buffer, line, sizeof(buffer) - 1);
+        buffer[sizeof(buffer) - 1] = '\0';
+        strncpy(raw_string, line, RAW_STRING_LEN - 1);
+        raw_string[RAW_STRING_LEN - 1] = '\0';
+        p = buffer;
+        ch = strsep(&p, ",");
+        if (ch == 0 || strncmp(ch, "MSG", 3) != 0)
+        {
+                TRACE_STOP(TRACE_TOKENISE, tokenise_start);
+                return -1;
+        }
+
+        ++tc->stats.message_count;
+        message_id = 0;
+        icao = 0;
+        ch = strsep(&p, ",");
+        if (ch)
+        {
+                message_id = strtoul(ch, 0, 0);
+                ch = strsep(&p, ",");
+                if (ch)
+                {
+                        ch = strsep(&p, ",");
+                        if (ch)
+                        {
+                                ch = strsep(&p, ",");
+                                if (ch)
+                                        icao = strtoul(ch, 0, 16);
+                        }
+                }
+        }
+        TRACE_STOP(TRACE_TOKENISE, tokenise_start);
+        if (ch)
+                return ProcessPlane(&p, tc, message_id, icao, raw_string);
+
+        return 0;
+}
+
+// Expire planes not heard from recently and report any new close encounters
+void
+tc_detect(tc_t *tc)
+{
+        TRACE_START(clean_start);
+
+        CleanPlanes(tc, tc->receiver_now);
+        TRACE_STOP(TRACE_CLEAN, clean_start);
+        TRACE_START(detect_start);
+        DetectClosePlanes(tc);
+        TRACE_STOP(TRACE_DETECT, detect_start);
+        if (tc->shm_table)
+                ShmPublishPlanes(tc);
+}
+
+void
+tc_get_stats(tc_t *tc, tc_stats_t *stats, int reset)
+{
+        *stats = tc->stats;
+        stats->plane_list_count = tc->plane_list_count;
+        if (reset)
+                memset(&tc->stats, 0, sizeof(tc->stats));
+}
+
+void
+tc_set_metar_station(tc_t *tc, const char *station)
+{
+        if (station == 0)
+                station = "";
+        strncpy(tc->metar_station, station, sizeof(tc->metar_station) - 1);
+}
+
+void
+tc_set_metar_callback(tc_t *tc, tc_metar_fn metar, void *arg)
+{
+        tc->metar = metar;
+        tc->metar_arg = arg;
+}
+
+int
+tc_shm_publish(tc_t *tc, const char *name)
+{
+        if (tc->shm_table)
+        {
+                errno = EBUSY;
+                return -1;
+        }
+        if ((tc->shm_name = strdup(name)) == 0)
+                return -1;
+        if ((tc->shm_table = TcShmTableCreate(name, &tc->shm_lock_fd)) == 0)
+        {
+                free(tc->shm_name);
+                tc->shm_name = 0;
+                return -1;
+        }
+
+        return 0;
+}
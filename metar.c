@@ -8,7 +8,6 @@
 #include <unistd.h>
 #include <time.h>
 #include <inttypes.h>
-#include <assert.h>
 #include <libxml/xmlreader.h>
 #include "metar.h"
 
@@ -18,6 +17,7 @@ static const char *AviationWeatherFormat = "https://aviationweather.gov/api/data
 	"taf=false&"
 	"format=xml";
 
+#define FETCH_TIMEOUT 10 // seconds, the fetch runs on the caller's thread
 #define XML_BUFFER_SIZE 65536
 static char XML_buffer[XML_BUFFER_SIZE];
 static int XML_buffer_index;
@@ -26,7 +26,8 @@ static size_t
 ReceiveXMLData(void *buffer, size_t size, size_t nmemb, void *stream)
 {
 	size *= nmemb;
-	assert(XML_buffer_index + size < XML_BUFFER_SIZE);
+	if (XML_buffer_index + size >= XML_BUFFER_SIZE)
+		return 0; // makes curl fail the transfer
 	strncpy(&XML_buffer[XML_buffer_index], buffer, size);
 	XML_buffer_index += size;
 
@@ -39,13 +40,11 @@ METARFetchNow(const char *station, time_t now, double *temp_c, double *elevation
 	char url[4096];
 	CURL *curlhandle;
 	CURLcode curl_status;
-	FILE *fp;
 	xmlTextReaderPtr reader;
 	int reader_status;
 	int temp_c_next;
 	int elevation_m_next;
 	const xmlChar *name, *value;
-	static const char *metar_fn = "latestmetar.xml";
 	static uint32_t initialized = 0;
 
 	if (! initialized)
@@ -63,6 +62,8 @@ METARFetchNow(const char *station, time_t now, double *temp_c, double *elevation
 	curlhandle = curl_easy_init();
 	curl_easy_setopt(curlhandle, CURLOPT_URL, url);
 	curl_easy_setopt(curlhandle, CURLOPT_WRITEFUNCTION, ReceiveXMLData);
+	curl_easy_setopt(curlhandle, CURLOPT_TIMEOUT, FETCH_TIMEOUT);
+	curl_easy_setopt(curlhandle, CURLOPT_NOSIGNAL, 1L);
 	memset(XML_buffer, 0, XML_BUFFER_SIZE);
 	curl_status = curl_easy_perform(curlhandle);
 	curl_easy_cleanup(curlhandle);
@@ -72,19 +73,11 @@ METARFetchNow(const char *station, time_t now, double *temp_c, double *elevation
 		return -1;
 	}
 
-	if ((fp = fopen(metar_fn, "w")) == 0)
-	{
-		fprintf(stderr, "%s: error, cannot write METAR XML %s\n", __PRETTY_FUNCTION__, metar_fn);
-		exit(1);
-	}
-	fputs(XML_buffer, fp);
-	fclose(fp);
-
-	reader = xmlReaderForFile(metar_fn, NULL, 0);
+	reader = xmlReaderForMemory(XML_buffer, XML_buffer_index, url, NULL, 0);
 	if (reader == 0)
 	{
-		fprintf(stderr, "%s: unable to read METAR XML file %s\n", __PRETTY_FUNCTION__, metar_fn);
-		exit(1);
+		fprintf(stderr, "%s: unable to read METAR XML from %s\n", __PRETTY_FUNCTION__, url);
+		return -1;
 	}
 	temp_c_next = 0;
 	elevation_m_next = 0;
@@ -113,25 +106,28 @@ METARFetchNow(const char *station, time_t now, double *temp_c, double *elevation
 	}
 	xmlFreeTextReader(reader);
 	if (reader_status != 0)
-		fprintf(stderr, "Warning: %s parsing problem in METAR XML file %s\n", __PRETTY_FUNCTION__, metar_fn);
+		fprintf(stderr, "Warning: %s parsing problem in METAR XML from %s\n", __PRETTY_FUNCTION__, url);
 
 	return reader_status;
 }
 
-void
-METARFetch(const char *station, double *temp_c, double *elevation_m)
+// Returns 1 if the cached values were refreshed from the server (blocking
+// on the fetch), 0 if the cache was still fresh
+int
+TcMETARFetch(const char *station, double *temp_c, double *elevation_m)
 {
 	time_t now, duration;
-	double old_temp, new_temp, new_elevation;
+	int refreshed;
+	double new_temp, new_elevation;
 	static double temp_c_cached = 15.0;
 	static double elevation_m_cached = 0.0;
 	static time_t last_fetch = 0;
 
+	refreshed = 0;
 	now = time(0);
 	duration = now - last_fetch;
 	if (duration >= 30 * 60) // don't thrash the server, fetch the temp every 30 minutes
 	{
-		old_temp = temp_c_cached;
 		// Deal with occasional empty or bad xml from data server
 		if (METARFetchNow(station, now, &new_temp, &new_elevation) == 0)
 		{
@@ -139,8 +135,10 @@ METARFetch(const char *station, double *temp_c, double *elevation_m)
 			elevation_m_cached = new_elevation;
 		}
 		last_fetch = now;
-		printf("%s (elevation %.1fm) METAR refresh. Old %.1fC, new %.1fC.\n", station, elevation_m_cached, old_temp, temp_c_cached);
+		refreshed = 1;
 	}
 	*temp_c = temp_c_cached;
 	*elevation_m = elevation_m_cached;
+
+	return refreshed;
 }
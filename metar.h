@@ -1 +1 @@
-extern void METARFetch(const char *station, double *temp_c, double *elevation_m);
+extern int TcMETARFetch(const char *station, double *temp_c, double *elevation_m);
@@ -0,0 +1,133 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <getopt.h>
+#include <unistd.h>
+#include "shmreader.h"
+
+// Example reader for the table published by tooclose -s
+
+static shm_table_t Snapshot;
+
+static int64_t
+MonotonicMs(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void
+PrintPlane(const char *prefix, const shm_plane_t *plane)
+{
+	printf("%s%06X %-8.8s %9.5f,%10.5f %6dft %4dkts\n", prefix,
+	       plane->icao,
+	       plane->callsign,
+	       plane->latitude,
+	       plane->longitude,
+	       plane->altitude,
+	       plane->speed);
+}
+
+int
+main(int argc, char *argv[])
+{
+	int opt, usage, interval, status;
+	int64_t idle_ms;
+	uint32_t i;
+	uint64_t e, next_encounter;
+	const char *name;
+	const shm_table_t *table;
+	const shm_encounter_t *encounter;
+	time_t t;
+
+	name = SHM_TABLE_DEFAULT_NAME;
+	interval = 5;
+	usage = 0;
+	while ((opt = getopt(argc, argv, "s:i:")) != EOF)
+		switch (opt)
+		{
+		case 's' :
+			name = optarg;
+			break;
+		case 'i' :
+			interval = atoi(optarg);
+			break;
+		default :
+			usage = 1;
+			break;
+		}
+	if (usage || interval <= 0)
+	{
+		fprintf(stderr, "usage: %s [-s name] [-i seconds]\n", argv[0]);
+		fprintf(stderr, "\t-s = shared memory name, default %s\n", SHM_TABLE_DEFAULT_NAME);
+		fprintf(stderr, "\t-i = seconds between table dumps, default 5\n");
+
+		return 1;
+	}
+
+	if ((table = ShmTableAttach(name)) == 0)
+	{
+		fprintf(stderr, "%s: cannot attach to %s, is tooclose -s running?\n", argv[0], name);
+		return 1;
+	}
+
+	next_encounter = 0;
+	while (1)
+	{
+		if (table == 0)
+		{
+			// previous writer closed the table, wait for the next one
+			sleep(interval);
+			if ((table = ShmTableAttach(name)) != 0)
+			{
+				fprintf(stderr, "%s: attached to %s\n", argv[0], name);
+				next_encounter = 0;
+			}
+			continue;
+		}
+		status = ShmTableSnapshot(table, &Snapshot);
+		if (status == SHM_SNAPSHOT_CLOSED)
+		{
+			fprintf(stderr, "%s: writer closed %s, waiting for it to return\n", argv[0], name);
+			ShmTableDetach(table);
+			table = 0;
+			continue;
+		}
+		if (status != SHM_SNAPSHOT_OK)
+		{
+			fprintf(stderr, "%s: writer busy, skipping\n", argv[0]);
+			sleep(interval);
+			continue;
+		}
+		t = Snapshot.receiver_now;
+		idle_ms = MonotonicMs() - Snapshot.updated_ms;
+		if (Snapshot.updated_ms && idle_ms > interval * 1000) // zero until the first update
+			printf("writer idle for %.1fs, ", idle_ms / 1000.0);
+		printf("%u planes at %s", Snapshot.plane_count, ctime(&t));
+		for (i = 0; i < Snapshot.plane_count; ++i)
+			if (Snapshot.planes[i].latlong_valid)
+				PrintPlane("\t", &Snapshot.planes[i]);
+
+		if (Snapshot.encounter_count > next_encounter + SHM_ENCOUNTER_COUNT)
+			next_encounter = Snapshot.encounter_count - SHM_ENCOUNTER_COUNT; // lapped by the writer
+		for (e = next_encounter; e < Snapshot.encounter_count; ++e)
+		{
+			encounter = &Snapshot.encounters[e % SHM_ENCOUNTER_COUNT];
+			t = encounter->time;
+			printf("encounter horiz: %2.3f, vert: %d, time: %s", encounter->horiz_sep, encounter->verti_sep, ctime(&t));
+			PrintPlane("\t0: ", &encounter->plane[0]);
+			PrintPlane("\t1: ", &encounter->plane[1]);
+		}
+		next_encounter = Snapshot.encounter_count;
+
+		fflush(stdout);
+		sleep(interval);
+	}
+
+	return 0;
+}
@@ -0,0 +1,81 @@
+#include <stdio.h>
+#include <stddef.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "shmreader.h"
+
+#define SNAPSHOT_TRIES 1000
+
+// Returns 0 if the segment does not exist or is not a compatible tooclose table
+const shm_table_t *
+ShmTableAttach(const char *name)
+{
+	int fd;
+	struct stat st;
+	const shm_table_t *table;
+
+	if ((fd = shm_open(name, O_RDONLY, 0)) < 0)
+		return 0;
+	if (fstat(fd, &st) != 0 || st.st_size < sizeof(shm_table_t))
+	{
+		close(fd);
+		return 0;
+	}
+	table = mmap(0, sizeof(shm_table_t), PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (table == MAP_FAILED)
+		return 0;
+	if (__atomic_load_n(&table->magic, __ATOMIC_ACQUIRE) != SHM_TABLE_MAGIC || table->version != SHM_TABLE_VERSION)
+	{
+		munmap((void *)table, sizeof(shm_table_t));
+		return 0;
+	}
+
+	return table;
+}
+
+// Copy a consistent view of the table into snapshot, only the first
+// plane_count entries of snapshot->planes are filled in. Returns
+// SHM_SNAPSHOT_OK, SHM_SNAPSHOT_BUSY if the writer kept the table busy for
+// every attempt or SHM_SNAPSHOT_CLOSED if the writer has closed the table.
+int
+ShmTableSnapshot(const shm_table_t *table, shm_table_t *snapshot)
+{
+	int tries;
+	uint32_t seq0, seq1, plane_count;
+
+	for (tries = 0; tries < SNAPSHOT_TRIES; ++tries)
+	{
+		seq0 = __atomic_load_n(&table->seq, __ATOMIC_ACQUIRE);
+		if (seq0 & 1)
+		{
+			sched_yield();
+			continue;
+		}
+		memcpy(snapshot, table, offsetof(shm_table_t, planes));
+		plane_count = snapshot->plane_count;
+		if (plane_count > SHM_PLANE_COUNT) // torn read, seq check below will reject it
+			plane_count = SHM_PLANE_COUNT;
+		memcpy(snapshot->planes, table->planes, plane_count * sizeof(shm_plane_t));
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		seq1 = __atomic_load_n(&table->seq, __ATOMIC_RELAXED);
+		if (seq0 == seq1)
+		{
+			if (snapshot->closed || __atomic_load_n(&table->magic, __ATOMIC_RELAXED) != SHM_TABLE_MAGIC)
+				return SHM_SNAPSHOT_CLOSED;
+			return SHM_SNAPSHOT_OK;
+		}
+	}
+
+	return SHM_SNAPSHOT_BUSY;
+}
+
+void
+ShmTableDetach(const shm_table_t *table)
+{
+	munmap((void *)table, sizeof(shm_table_t));
+}
@@ -0,0 +1,24 @@
+#ifndef SHMREADER_H
+#define SHMREADER_H
+
+#include "shmtable.h"
+
+// Reader side of the shared memory table, link with libtoocloseshm.a
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SHM_SNAPSHOT_OK 0
+#define SHM_SNAPSHOT_BUSY -1 // writer kept the table busy, try again later
+#define SHM_SNAPSHOT_CLOSED -2 // writer has gone, detach and attach again
+
+extern const shm_table_t *ShmTableAttach(const char *name);
+extern int ShmTableSnapshot(const shm_table_t *table, shm_table_t *snapshot);
+extern void ShmTableDetach(const shm_table_t *table);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
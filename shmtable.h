@@ -0,0 +1,58 @@
+#ifndef SHMTABLE_H
+#define SHMTABLE_H
+
+#include <stdint.h>
+
+// Layout of the POSIX shared memory segment published by tooclose -s,
+// shmwriter.h is the writer side and shmreader.h the reader side.
+//
+// The writer bumps seq to an odd value before touching the table and to the
+// next even value when done. Readers copy the table and retry if seq was odd
+// or changed during the copy, so they never block the writer.
+//
+// When tooclose exits it sets closed and unlinks the segment, readers that
+// see closed should detach and attach again to pick up the next writer.
+// updated_ms is the writer's CLOCK_MONOTONIC time of its last update so
+// readers can spot a writer that died without closing.
+
+#define SHM_TABLE_MAGIC 0x544F4F43 // "TOOC"
+#define SHM_TABLE_VERSION 2
+#define SHM_TABLE_DEFAULT_NAME "/tooclose"
+
+#define SHM_PLANE_COUNT 1024 // at least PLANE_COUNT in libtooclose.c
+#define SHM_ENCOUNTER_COUNT 64 // ring of most recent close encounters
+#define SHM_CALLSIGN_LEN 16
+
+typedef struct shm_plane_t {
+	uint32_t icao;
+	char callsign[SHM_CALLSIGN_LEN];
+	int64_t last_seen;
+	int64_t last_location_time;
+	float latitude;
+	float longitude;
+	int32_t altitude;
+	int32_t speed;
+	uint32_t latlong_valid;
+} shm_plane_t;
+
+typedef struct shm_encounter_t {
+	int64_t time;
+	double horiz_sep;
+	int32_t verti_sep;
+	shm_plane_t plane[2];
+} shm_encounter_t;
+
+typedef struct shm_table_t {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t seq;
+	uint32_t plane_count;
+	uint32_t closed;
+	int64_t updated_ms;
+	uint64_t encounter_count; // total ever written, ring slot is count % SHM_ENCOUNTER_COUNT
+	int64_t receiver_now;
+	shm_encounter_t encounters[SHM_ENCOUNTER_COUNT];
+	shm_plane_t planes[SHM_PLANE_COUNT]; // last so readers only copy plane_count entries
+} shm_table_t;
+
+#endif
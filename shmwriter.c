@@ -0,0 +1,88 @@
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include "shmwriter.h"
+
+// Returns 0 with errno set if the segment cannot be opened, sized or
+// mapped, or EBUSY if another writer holds it. The writer keeps *lock_fd
+// open and locked until TcShmTableDestroy(), a crashed writer's lock goes
+// away with it so its stale segment can be taken over.
+shm_table_t *
+TcShmTableCreate(const char *name, int *lock_fd)
+{
+	int fd, saved_errno;
+	shm_table_t *table;
+
+	if ((fd = shm_open(name, O_CREAT | O_RDWR, 0644)) < 0)
+		return 0;
+	if (flock(fd, LOCK_EX | LOCK_NB) != 0)
+	{
+		saved_errno = errno == EWOULDBLOCK ? EBUSY : errno;
+		close(fd);
+		errno = saved_errno;
+		return 0;
+	}
+	if (ftruncate(fd, sizeof(shm_table_t)) != 0)
+	{
+		saved_errno = errno;
+		close(fd);
+		errno = saved_errno;
+		return 0;
+	}
+	table = mmap(0, sizeof(shm_table_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (table == MAP_FAILED)
+	{
+		saved_errno = errno;
+		close(fd);
+		errno = saved_errno;
+		return 0;
+	}
+	*lock_fd = fd;
+
+	// a stale segment from a previous run may still have readers attached
+	__atomic_store_n(&table->magic, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&table->seq, 0, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	table->version = SHM_TABLE_VERSION;
+	table->plane_count = 0;
+	table->closed = 0;
+	table->updated_ms = 0;
+	table->encounter_count = 0;
+	table->receiver_now = 0;
+	__atomic_store_n(&table->magic, SHM_TABLE_MAGIC, __ATOMIC_RELEASE);
+
+	return table;
+}
+
+void
+TcShmTableWriteBegin(shm_table_t *table)
+{
+	__atomic_store_n(&table->seq, table->seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+void
+TcShmTableWriteEnd(shm_table_t *table)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	table->updated_ms = (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+	__atomic_store_n(&table->seq, table->seq + 1, __ATOMIC_RELEASE);
+}
+
+void
+TcShmTableDestroy(shm_table_t *table, const char *name, int lock_fd)
+{
+	TcShmTableWriteBegin(table);
+	table->closed = 1;
+	TcShmTableWriteEnd(table);
+	munmap(table, sizeof(shm_table_t));
+	shm_unlink(name);
+	close(lock_fd); // unlink first so the next writer gets a fresh segment
+}
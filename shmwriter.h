@@ -0,0 +1,8 @@
+#include "shmtable.h"
+
+// Writer side of the shared memory table, used by libtooclose
+
+extern shm_table_t *TcShmTableCreate(const char *name, int *lock_fd);
+extern void TcShmTableWriteBegin(shm_table_t *table);
+extern void TcShmTableWriteEnd(shm_table_t *table);
+extern void TcShmTableDestroy(shm_table_t *table, const char *name, int lock_fd);
@@ -0,0 +1,94 @@
+#ifndef TOOCLOSE_H
+#define TOOCLOSE_H
+
+#include <stdint.h>
+#include <time.h>
+
+// libtooclose, the close encounter detector without the stdin/stdout front end
+//
+// Feed aircraft updates with tc_update_*() or raw BaseStation lines with
+// tc_process_sbs(), then call tc_detect() to expire stale aircraft and run
+// detection. Close encounters are handed to the alert callback. A tc_t is
+// not thread safe, drive it from one thread.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TC_CALLSIGN_LEN 16
+#define TC_RAW_STRING_LEN 256
+
+typedef struct tc_t tc_t;
+
+typedef struct tc_aircraft_t {
+        uint32_t icao;
+        char callsign[TC_CALLSIGN_LEN];
+        time_t last_seen;
+        time_t last_location_time;
+        float latitude;
+        float longitude;
+        int32_t altitude; // feet
+        int32_t speed; // kts
+        char msg3[TC_RAW_STRING_LEN]; // last BaseStation position message, empty unless fed by tc_process_sbs()
+} tc_aircraft_t;
+
+typedef struct tc_alert_t {
+        tc_aircraft_t plane[2];
+        double horiz_sep; // nautical miles
+        int32_t verti_sep; // feet
+} tc_alert_t;
+
+typedef void (*tc_alert_fn)(const tc_alert_t *alert, void *arg);
+typedef void (*tc_metar_fn)(const char *station, double elevation_m, double old_temp_c, double new_temp_c, void *arg);
+
+typedef struct tc_stats_t {
+        uint32_t message_count;
+        uint32_t max_plane_count;
+        uint32_t flight_count;
+        uint32_t plane_list_count;
+} tc_stats_t;
+
+extern tc_t *tc_create(tc_alert_fn alert, void *arg);
+extern void tc_destroy(tc_t *tc);
+
+// t_ms is receiver time in ms since the epoch, the update functions return
+// 0 if the data was accepted and -1 if it was out of range or the aircraft
+// table is full. A rejected update is counted as a message but otherwise
+// ignored, the aircraft is not added or marked as seen.
+//
+// The table holds 1024 aircraft. Aircraft not heard from for 10 seconds of
+// receiver time are only expired by tc_detect(), so call it often enough
+// that the aircraft heard between calls fit. Updates dropped for a full
+// table still advance the receiver clock so the next tc_detect() can
+// expire stale aircraft. tc_process_sbs() returns -1
+// for lines that are not MSG lines and for lines dropped because the
+// table is full.
+extern int tc_update_seen(tc_t *tc, uint32_t icao, int64_t t_ms);
+extern int tc_update_position(tc_t *tc, uint32_t icao, int64_t t_ms, double lat, double lon, int32_t alt);
+extern int tc_update_speed(tc_t *tc, uint32_t icao, int64_t t_ms, int32_t speed);
+extern int tc_update_callsign(tc_t *tc, uint32_t icao, int64_t t_ms, const char *callsign);
+extern int tc_process_sbs(tc_t *tc, const char *line);
+
+extern void tc_detect(tc_t *tc);
+extern void tc_get_stats(tc_t *tc, tc_stats_t *stats, int reset);
+
+// METAR refresh is off until a station is set, e.g. "KVNY" from
+// https://www.aviationweather.gov/docs/metar/stations.txt, null turns it
+// off again. Once on, accepted positions refresh the METAR every 30
+// minutes with a blocking HTTP fetch, up to 10 seconds, on the calling
+// thread. The METAR cache is process wide: use a single station and drive
+// every tc_t with METAR on from the same thread. The callback runs after
+// each refresh, the library itself doesn't print it.
+extern void tc_set_metar_station(tc_t *tc, const char *station);
+extern void tc_set_metar_callback(tc_t *tc, tc_metar_fn metar, void *arg);
+
+// Mirror the aircraft table into POSIX shared memory, see shmtable.h.
+// Returns -1 with errno set if the segment cannot be set up, errno is EBUSY
+// if this tc_t or another process is already publishing under that name.
+extern int tc_shm_publish(tc_t *tc, const char *name);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
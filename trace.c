@@ -0,0 +1,151 @@
+#include "trace.h"
+
+#ifdef TC_TRACE
+
+#include <inttypes.h>
+
+// HdrHistogram style buckets, 16 linear sub-buckets per power of two so
+// every recorded value is within about 6% of its bucket bounds
+#define SUB_BITS 4
+#define SUB_COUNT (1 << SUB_BITS)
+#define MAX_MSB 47 // values up to 2^48 - 1 ns, about 78 hours, longer values are clamped
+#define BUCKET_COUNT ((MAX_MSB - SUB_BITS + 2) * SUB_COUNT)
+
+typedef struct histogram_t {
+        uint64_t max;
+        uint64_t buckets[BUCKET_COUNT];
+} histogram_t;
+
+static histogram_t Histograms[TRACE_STAGE_COUNT];
+
+static const char *StageNames[TRACE_STAGE_COUNT] = {
+        "read (incl. wait)",
+        "tokenise",
+        "TcDate2EpochMs",
+        "table lookup",
+        "METAR",
+        "CleanPlanes",
+        "DetectClosePlanes",
+        "report/log",
+        "receiver to alert",
+};
+
+static uint32_t
+BucketIndex(uint64_t ns)
+{
+        int msb;
+
+        if (ns < SUB_COUNT)
+                return ns;
+        if (ns >> (MAX_MSB + 1))
+                ns = (UINT64_C(1) << (MAX_MSB + 1)) - 1;
+        msb = 63 - __builtin_clzll(ns);
+
+        return (msb - SUB_BITS + 1) * SUB_COUNT + ((ns >> (msb - SUB_BITS)) - SUB_COUNT);
+}
+
+// highest value that lands in bucket i
+static uint64_t
+BucketValue(uint32_t i)
+{
+        int shift;
+
+        if (i < SUB_COUNT)
+                return i;
+        shift = i / SUB_COUNT - 1;
+
+        return ((uint64_t)(i % SUB_COUNT + SUB_COUNT + 1) << shift) - 1;
+}
+
+void
+TcTraceRecord(trace_stage_t stage, uint64_t ns)
+{
+        histogram_t *h;
+        uint64_t max;
+
+        h = &Histograms[stage];
+        __atomic_fetch_add(&h->buckets[BucketIndex(ns)], 1, __ATOMIC_RELAXED);
+        max = __atomic_load_n(&h->max, __ATOMIC_RELAXED);
+        while (ns > max && ! __atomic_compare_exchange_n(&h->max, &max, ns, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+                ;
+}
+
+// receiver_ms is the receiver's wall clock timestamp of the message that led to an alert
+void
+TcTraceReceiverDelay(int64_t receiver_ms)
+{
+        struct timespec ts;
+        int64_t delay_ms;
+
+        clock_gettime(CLOCK_REALTIME, &ts);
+        delay_ms = (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000 - receiver_ms;
+        if (delay_ms < 0) // receiver clock ahead of ours
+                delay_ms = 0;
+        TcTraceRecord(TRACE_RECEIVER_TO_ALERT, (uint64_t)delay_ms * 1000000);
+}
+
+static double
+Percentile(uint64_t buckets[BUCKET_COUNT], uint64_t count, uint64_t max, double p)
+{
+        uint32_t i;
+        uint64_t target, seen, value;
+
+        target = (uint64_t)(count * p / 100.0 + 0.5);
+        if (target == 0)
+                target = 1;
+        seen = 0;
+        value = max;
+        for (i = 0; i < BUCKET_COUNT; ++i)
+        {
+                seen += buckets[i];
+                if (seen >= target)
+                {
+                        value = BucketValue(i);
+                        break;
+                }
+        }
+        if (value > max)
+                value = max;
+
+        return value / 1000.0;
+}
+
+void
+TcTraceReport(FILE *fp, int reset)
+{
+        int stage;
+        uint32_t i;
+        uint64_t count, max;
+        uint64_t buckets[BUCKET_COUNT];
+        histogram_t *h;
+
+        fprintf(fp, "%25s: %12s %10s %10s %10s %10s %10s\n", "latency (us)", "count", "p50", "p90", "p99", "p99.9", "max");
+        for (stage = 0; stage < TRACE_STAGE_COUNT; ++stage)
+        {
+                h = &Histograms[stage];
+                count = 0;
+                for (i = 0; i < BUCKET_COUNT; ++i)
+                {
+                        buckets[i] = __atomic_load_n(&h->buckets[i], __ATOMIC_RELAXED);
+                        count += buckets[i];
+                }
+                max = __atomic_load_n(&h->max, __ATOMIC_RELAXED);
+                if (count == 0)
+                        fprintf(fp, "%25s: %12d\n", StageNames[stage], 0);
+                else
+                        fprintf(fp, "%25s: %12" PRIu64 " %10.1f %10.1f %10.1f %10.1f %10.1f\n", StageNames[stage], count,
+                                Percentile(buckets, count, max, 50.0),
+                                Percentile(buckets, count, max, 90.0),
+                                Percentile(buckets, count, max, 99.0),
+                                Percentile(buckets, count, max, 99.9),
+                                max / 1000.0);
+                if (reset)
+                {
+                        for (i = 0; i < BUCKET_COUNT; ++i)
+                                __atomic_fetch_sub(&h->buckets[i], buckets[i], __ATOMIC_RELAXED);
+                        __atomic_store_n(&h->max, 0, __ATOMIC_RELAXED);
+                }
+        }
+}
+
+#endif
@@ -0,0 +1,51 @@
+// Per-stage latency tracing, build with make TRACE=1 to enable.
+//
+// Stage timings go into log-linear histograms with lock free counters.
+// Without TC_TRACE the macros expand to nothing and nothing is linked in.
+
+#ifdef TC_TRACE
+
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+typedef enum trace_stage_t {
+        TRACE_READ,
+        TRACE_TOKENISE,
+        TRACE_DATE2EPOCH,
+        TRACE_LOOKUP,
+        TRACE_METAR,
+        TRACE_CLEAN,
+        TRACE_DETECT,
+        TRACE_REPORT,
+        TRACE_RECEIVER_TO_ALERT,
+        TRACE_STAGE_COUNT
+} trace_stage_t;
+
+static inline uint64_t
+TraceNow(void)
+{
+        struct timespec ts;
+
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+
+        return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+extern void TcTraceRecord(trace_stage_t stage, uint64_t ns);
+extern void TcTraceReceiverDelay(int64_t receiver_ms);
+extern void TcTraceReport(FILE *fp, int reset);
+
+#define TRACE_START(var) uint64_t var = TraceNow()
+#define TRACE_STOP(stage, var) TcTraceRecord(stage, TraceNow() - (var))
+#define TRACE_RECEIVER_DELAY(receiver_ms) TcTraceReceiverDelay(receiver_ms)
+#define TRACE_REPORT(fp, reset) TcTraceReport(fp, reset)
+
+#else
+
+#define TRACE_START(var)
+#define TRACE_STOP(stage, var)
+#define TRACE_RECEIVER_DELAY(receiver_ms)
+#define TRACE_REPORT(fp, reset)
+
+#endif